@@ -0,0 +1,111 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+#ifdef _MSC_VER
+#define _STL_CRT_SECURE_INVALID_PARAMETER(expr) _CRT_SECURE_INVALID_PARAMETER(expr)
+#endif
+#include <pybind11/embed.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "py_multithread_helpers.hh"
+#include "py_call_cache.hh"
+
+namespace py = pybind11;
+using namespace py::literals;
+
+using AddCache = PythonCallCache<int, int, int>;
+
+void Process(int thread_idx, AddCache &cache, const AddCache::PureFunction &add) {
+    std::cout << "Thread started: " << thread_idx << std::endl;
+
+    // Each thread must use its own thread state object
+    auto thread_state = PythonEnvironment::GetInstance().CreateThreadState();
+
+    for (int i = 0; i < 1000; ++i) {
+        try {
+            // No GIL locking here. Cache locks the thread state only
+            // if the result is not yet known.
+            int n = cache.Call(*thread_state, add, i % 10, 2);
+            if (n != i % 10 + 2) {
+                std::cout << "Wrong result from cache: " << n << std::endl;
+                break;
+            }
+        } catch(const std::exception &e) {
+            std::cout << "Python code raised exception: " << std::endl;
+            std::cout << e.what() << std::endl;
+            break;
+        }
+    }
+
+    std::cout << "Thread exiting: " << thread_idx << std::endl;
+}
+
+int main() {
+    // Init Python
+    PythonEnvironment& env = PythonEnvironment::GetInstance();
+
+    {
+        // Setup paths
+        auto ts = env.CreateThreadState();
+        auto lock = ts->GetLock();
+        try {
+            py::exec(R"(
+                # Add current working directory and subdir to module search path
+                # If build is under cwd, we catch the example modules.
+                import sys,os;
+                sys.path.append(os.getcwd())
+                sys.path.append(os.path.join(os.getcwd(), '..'))
+                sys.path.append(os.path.join(os.getcwd(), '..', '..'))
+            )");
+        } catch(...) {
+            return 1;
+        }
+    }
+
+    AddCache::Options options;
+    options.ttl = std::chrono::seconds(10);
+    AddCache cache(options);
+
+    // Only functions which are marked pure are called through the cache
+    const auto add = cache.MarkPure("ex4_calc", "add");
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 20; ++i) {
+        threads.emplace_back([&, i](){Process(i, cache, add);});
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    const auto stats = cache.GetStats();
+    std::cout << "Cache hits: " << stats.hits
+        << ", misses: " << stats.misses
+        << ", coalesced: " << stats.coalesced
+        << ", evictions: " << stats.evictions << std::endl;
+}
@@ -0,0 +1,12 @@
+print('Python module loaded')
+
+import native_kernels as nk
+
+# Same as ex7_threaded2.sum, but runs natively without the GIL
+nk.register('elementwise_sum', nk.add(nk.arg(0), nk.arg(1)))
+
+# Same as ex5_sum.sum
+nk.register('sum', nk.reduce_sum(nk.arg(0) + nk.arg(1)))
+
+# 2 * x + y
+nk.register('axpy', nk.fma(nk.constant(2), nk.arg(0), nk.arg(1)))
@@ -0,0 +1,117 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+#ifdef _MSC_VER
+#define _STL_CRT_SECURE_INVALID_PARAMETER(expr) _CRT_SECURE_INVALID_PARAMETER(expr)
+#endif
+#include <pybind11/embed.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "py_multithread_helpers.hh"
+#include "py_native_kernels.hh"
+
+namespace py = pybind11;
+using namespace py::literals;
+
+// Make `import native_kernels` available to Python
+PYBIND11_EMBEDDED_MODULE(native_kernels, m) {
+    native_kernels::RegisterModule(m);
+}
+
+
+void Process(int thread_idx) {
+    std::cout << "Thread started: " << thread_idx << std::endl;
+
+    // Kernels were registered by Python, but running them does not need
+    // thread state or the GIL.
+    auto &registry = native_kernels::KernelRegistry::GetInstance();
+    auto elementwise_sum = registry.Find("elementwise_sum");
+    auto sum = registry.Find("sum");
+    if (!elementwise_sum || !sum) {
+        std::cout << "Kernels have not been registered" << std::endl;
+        return;
+    }
+
+    std::vector<int> data1;
+    std::vector<int> data2;
+    for (int i = 0; i < 10000; ++i) {
+        data1.push_back(i);
+        data2.push_back(i*2);
+    }
+    std::vector<int> out(data1.size());
+
+    for (int i = 0; i < 10; ++i) {
+        try {
+            elementwise_sum->Map<int>({data1.data(), data2.data()}, data1.size(), out.data());
+            int total = sum->Reduce<int>({data1.data(), data2.data()}, data1.size());
+
+            std::cout << "Thread " << thread_idx << " processing " << i
+                << ", last element: " << out.back() << ", sum: " << total << std::endl;
+        } catch(const std::exception &e) {
+            std::cout << "Kernel raised exception: " << std::endl;
+            std::cout << e.what() << std::endl;
+            break;
+        }
+    }
+}
+
+int main() {
+    // Init Python
+    PythonEnvironment& env = PythonEnvironment::GetInstance();
+
+    {
+        // Setup paths and let Python register the kernels
+        auto ts = env.CreateThreadState();
+        auto lock = ts->GetLock();
+        try {
+            py::exec(R"(
+                # Add current working directory and subdir to module search path
+                # If build is under cwd, we catch the example modules.
+                import sys,os;
+                sys.path.append(os.getcwd())
+                sys.path.append(os.path.join(os.getcwd(), '..'))
+                sys.path.append(os.path.join(os.getcwd(), '..', '..'))
+
+                import ex11_kernels
+            )");
+        } catch(const std::exception &e) {
+            std::cout << "Python code raised exception: " << std::endl;
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 20; ++i) {
+        threads.emplace_back([=](){Process(i);});
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+}
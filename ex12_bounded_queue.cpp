@@ -0,0 +1,118 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+#ifdef _MSC_VER
+#define _STL_CRT_SECURE_INVALID_PARAMETER(expr) _CRT_SECURE_INVALID_PARAMETER(expr)
+#endif
+#include <pybind11/embed.h>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include "py_multithread_helpers.hh"
+#include "py_bounded_queue.hh"
+
+namespace py = pybind11;
+using namespace py::literals;
+
+// Make `import bounded_queue` available to Python
+PYBIND11_EMBEDDED_MODULE(bounded_queue, m) {
+    RegisterBoundedQueueModule(m);
+}
+
+
+void Process(int thread_idx, StringQueue &queue) {
+    std::cout << "Thread started: " << thread_idx << std::endl;
+
+    for (int i = 0; i < 30; ++i) {
+        std::ostringstream message;
+        message << "Thread " << thread_idx << " iteration " << i;
+
+        // No GIL or thread state needed. If Python consumer falls behind,
+        // oldest messages are dropped instead of blocking this thread.
+        queue.Push(message.str());
+
+        using namespace std::chrono_literals;
+        std::this_thread::sleep_for(10ms);
+    }
+
+    std::cout << "Thread exiting: " << thread_idx << std::endl;
+}
+
+int main() {
+    // Init Python
+    PythonEnvironment& env = PythonEnvironment::GetInstance();
+
+    auto queue = std::make_shared<StringQueue>(16, OverflowPolicy::DropOldest);
+
+    // Closing the queue on shutdown lets the consumer thread exit, so
+    // shutdown can wait for it and finalize Python.
+    CloseOnShutdown(queue);
+
+    {
+        // Setup paths
+        auto ts = env.CreateThreadState();
+        auto lock = ts->GetLock();
+        try {
+            py::exec(R"(
+                # Add current working directory and subdir to module search path
+                # If build is under cwd, we catch the example modules.
+                import sys,os;
+                sys.path.append(os.getcwd())
+                sys.path.append(os.path.join(os.getcwd(), '..'))
+                sys.path.append(os.path.join(os.getcwd(), '..', '..'))
+            )");
+
+            // Start Python consumer thread
+            py::module_ consumer = py::module_::import("ex12_queue_consumer");
+            consumer.attr("start_consumer")(queue);
+        } catch(const std::exception &e) {
+            std::cout << "Python code raised exception: " << std::endl;
+            std::cout << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 20; ++i) {
+        threads.emplace_back([=](){Process(i, *queue);});
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    // Consumer processes remaining messages before it exits
+    using namespace std::chrono_literals;
+    std::cout << env.Shutdown(2000ms).ToString() << std::endl;
+
+    const auto stats = queue->GetStats();
+    std::cout << "Pushed: " << stats.pushed
+        << ", popped: " << stats.popped
+        << ", dropped: " << stats.dropped << std::endl;
+}
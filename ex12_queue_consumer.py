@@ -0,0 +1,31 @@
+print('Python module loaded')
+
+import threading
+import time
+
+consumer = None
+
+def consume(queue):
+    while True:
+        # GIL is released while waiting, so C++ threads and other
+        # Python threads can run.
+        message = queue.get()
+        if message is None:
+            # Queue is closed by C++ when Python is shut down and
+            # all messages have been consumed
+            break
+
+        print(message)
+
+        # Simulate slow consumer, for example GUI which updates only
+        # every now and then. Producers are not slowed down by this, old
+        # messages are just dropped.
+        time.sleep(0.01)
+
+    print('Consumer stopped. Max depth {}, dropped {}, coalesced {}'.format(
+        queue.max_depth, queue.dropped, queue.coalesced))
+
+def start_consumer(queue):
+    global consumer
+    consumer = threading.Thread(target=consume, args=(queue,))
+    consumer.start()
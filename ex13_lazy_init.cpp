@@ -0,0 +1,95 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+#ifdef _MSC_VER
+#define _STL_CRT_SECURE_INVALID_PARAMETER(expr) _CRT_SECURE_INVALID_PARAMETER(expr)
+#endif
+#include <pybind11/embed.h>
+#include <pybind11/stl.h>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include "py_multithread_helpers.hh"
+
+namespace py = pybind11;
+using namespace py::literals;
+
+
+
+void Process(int thread_idx) {
+    // Blocks only if Python is still initializing
+    auto thread_state = PythonEnvironment::GetInstance().CreateThreadState();
+
+    std::vector<int> data1{1, 2, 3};
+    std::vector<int> data2{4, 5, 6};
+    try {
+        auto lock = thread_state->GetLock(); // Lock GIL
+
+        // Module was already imported during warm-up
+        py::module_ calc = py::module_::import("ex7_threaded2");
+        py::object result = calc.attr("sum")(data1, data2);
+        auto n = result.cast<std::vector<int>>();
+
+        std::cout << "Thread " << thread_idx << " got vector with n elements: " << n.size() << std::endl;
+    } catch(const std::exception &e) {
+        std::cout << "Python code raised exception: " << std::endl;
+        std::cout << e.what() << std::endl;
+    }
+}
+
+int main() {
+    // Start Python and import heavy modules on a background thread.
+    // Main thread continues immediately.
+    PythonBackgroundInitOptions options;
+    options.setup_code = R"(
+        # Add current working directory and subdir to module search path
+        # If build is under cwd, we catch the example modules.
+        import sys,os;
+        sys.path.append(os.getcwd())
+        sys.path.append(os.path.join(os.getcwd(), '..'))
+        sys.path.append(os.path.join(os.getcwd(), '..', '..'))
+    )";
+    options.warm_imports = {"numpy", "ex7_threaded2"};
+    PythonEnvironment::StartBackgroundInit(options);
+
+    // Simulate other startup work which does not need Python
+    using namespace std::chrono_literals;
+    std::this_thread::sleep_for(100ms);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([=](){Process(i);});
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    PythonEnvironment& env = PythonEnvironment::GetInstance();
+    std::cout << env.GetInitMetrics().ToString() << std::endl;
+    std::cout << env.Shutdown(2000ms).ToString() << std::endl;
+}
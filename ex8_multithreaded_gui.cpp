@@ -93,6 +93,13 @@ int main() {
         )");
     }
 
+    // Tell the GUI thread to exit when shutting down, otherwise
+    // finalization would wait for it forever.
+    env.AddShutdownHook([]() {
+        py::module_ gui = py::module_::import("ex8_threaded_gui");
+        gui.attr("quit_gui")();
+    });
+
     std::vector<std::thread> threads;
     for (int i = 0; i < 20; ++i) {
         threads.emplace_back([=](){Process(i);});
@@ -100,4 +107,8 @@ int main() {
     for (auto &t : threads) {
         t.join();
     }
+
+    using namespace std::chrono_literals;
+    auto report = env.Shutdown(2000ms);
+    std::cout << report.ToString() << std::endl;
 }
@@ -7,6 +7,7 @@ import numpy as np
 
 gui_lock = threading.RLock()
 gui_message = ''
+gui_stop = threading.Event()
 
 def gui_loop():
     import tkinter as tk
@@ -15,7 +16,7 @@ def gui_loop():
     label = tk.Label(textvariable=label_text)
     label.pack()
 
-    while window.state() == "normal":
+    while window.state() == "normal" and not gui_stop.is_set():
         window.update_idletasks()
 
         with gui_lock:
@@ -24,12 +25,17 @@ def gui_loop():
         window.update()
         time.sleep(0.01)
 
+    window.destroy()
+
 def update_gui_info(th_idx):
     global gui_message
     with gui_lock:
         gui_message = 'Thread {} called. Here is a random number {}'.format(th_idx, np.random.rand())
     
+def quit_gui():
+    # Called from C++ shutdown hook, which then waits for the thread
+    gui_stop.set()
+
 # When we load the module first time, we create the GUI thread
 gui_th = threading.Thread(target=gui_loop)
-gui_th.start()
-# The GUI thread is not able to exit nicely in this example
\ No newline at end of file
+gui_th.start()
\ No newline at end of file
@@ -32,39 +32,35 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pybind11/embed.h>
 #include <pybind11/stl.h>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <vector>
 #include <thread>
 #include "py_multithread_helpers.hh"
+#include "py_bounded_queue.hh"
 
 namespace py = pybind11;
 using namespace py::literals;
 
+// Make `import bounded_queue` available to Python
+PYBIND11_EMBEDDED_MODULE(bounded_queue, m) {
+    RegisterBoundedQueueModule(m);
+}
 
-
-void Process(int thread_idx) {
+void Process(int thread_idx, StringQueue &queue) {
     std::cout << "Thread started: " << thread_idx << std::endl;
 
-    // Each thread must use its own thread state object
-    PythonThreadState thread_state = PythonEnvironment::GetInstance().CreateThreadState();
-
+    std::mt19937 rng(thread_idx);
+    std::uniform_real_distribution<double> dist;
     for (int i = 0; i < 30; ++i) {
-        try {
-            auto lock = thread_state.GetLock(); // Lock GIL
-
-            // We could move this import outside of the loop, but it
-            // we would need to ensure that when its freed, we also lock GIL, etc
-            // so it would needlessly complicate this example.
-            py::module_ gui = py::module_::import("ex9_threaded_gui2");
-
-            gui.attr("update_gui_info")(thread_idx);
-        } catch(const std::exception &e) {
-            std::cout << "Python code raised exception: " << std::endl;
-            std::cout << e.what() << std::endl;
-            break;
-        }
-
-        // No need to sleep as Python process is separate one and will have
-        // its own GIL
+        std::ostringstream gui_message;
+        gui_message << "Thread " << thread_idx << " called. Here is a random number " << dist(rng);
+
+        // No GIL needed. GUI shows only the latest status, so when the GUI
+        // process falls behind, the newest queued message is replaced
+        // instead of blocking this thread.
+        queue.Push(gui_message.str());
     }
 
     std::cout << "Thread exiting: " << thread_idx << std::endl;
@@ -74,10 +70,12 @@ int main() {
     // Init Python
     PythonEnvironment& env = PythonEnvironment::GetInstance();
 
+    auto queue = std::make_shared<StringQueue>(4, OverflowPolicy::CoalesceLatest);
+
     {
         // Setup paths
         auto ts = env.CreateThreadState();
-        auto lock = ts.GetLock();
+        auto lock = ts->GetLock();
         py::exec(R"(
             # Add current working directory and subdir to module search path
             # If build is under cwd, we catch the example modules.
@@ -87,28 +85,27 @@ int main() {
             sys.path.append(os.path.join(os.getcwd(), '..', '..'))
         )");
 
-        // Start GUI process
-        py::exec(R"(
-            import ex9_threaded_gui2
-            ex9_threaded_gui2.start_gui_process()
-        )");
+        // Start GUI process and thread which forwards messages from the queue
+        py::module_ gui = py::module_::import("ex9_threaded_gui2");
+        gui.attr("start_gui_process")(queue);
     }
 
+    // Stop GUI process when shutting down. Shutdown waits for the process
+    // and terminates it if it does not exit in time.
+    env.AddShutdownHook([]() {
+        py::module_ gui = py::module_::import("ex9_threaded_gui2");
+        gui.attr("quit_gui")();
+    });
+
     std::vector<std::thread> threads;
     for (int i = 0; i < 20; ++i) {
-        threads.emplace_back([&](){Process(i);});
+        threads.emplace_back([=](){Process(i, *queue);});
     }
     for (auto &t : threads) {
         t.join();
     }
 
-    {
-        auto ts = env.CreateThreadState();
-        auto lock = ts.GetLock();
-
-        // Stop gui
-        py::exec(R"(
-            ex9_threaded_gui2.quit_gui()
-        )");
-    }
+    using namespace std::chrono_literals;
+    auto report = env.Shutdown(2000ms);
+    std::cout << report.ToString() << std::endl;
 }
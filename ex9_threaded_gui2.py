@@ -4,7 +4,6 @@ import threading
 import time
 # import numpy as np # Had problems importing numpy fro some reason
 from multiprocessing import Process, Pipe
-import random
 
 def cli_loop(conn):
     while True:
@@ -40,40 +39,51 @@ def gui_loop2(conn):
 
 parent_conn = None
 child_conn = None
-conn_lock = None
 process = None
-def update_gui_info(th_idx):
-    global conn_lock
-    global parent_conn
-    with conn_lock:
-        gui_message = 'Thread {} called. Here is a random number {}'.format(th_idx, random.random())
+status_queue = None
+forwarder = None
+
+def forward_loop(queue):
+    # Only this thread writes to the pipe, so no lock is needed. If the GUI
+    # process falls behind, only this thread blocks in send. C++ producers
+    # keep running and the queue coalesces their messages.
+    while True:
+        # GIL is released while waiting
+        gui_message = queue.get()
+        if gui_message is None:
+            # Queue closed and all messages forwarded
+            break
         parent_conn.send(gui_message)
+    parent_conn.send('quit')
 
-def start_gui_process():
+def start_gui_process(queue):
     global parent_conn
     global child_conn
-    global conn_lock
     global process
-    conn_lock = threading.RLock()
+    global status_queue
+    global forwarder
     parent_conn, child_conn = Pipe()
 
     # Check if tkinter can be imported
     try:
         import tkinter as tk
         # Success, we can create the GUI
-        fun = gui_loop
+        fun = gui_loop2
     except:
         # Failure, use text output
         fun = cli_loop
 
     process = Process(target=fun, args=(child_conn,))
     process.start()
-    # The GUI process is not able to exit nicely in this example
+
+    status_queue = queue
+    forwarder = threading.Thread(target=forward_loop, args=(queue,))
+    forwarder.start()
 
 def quit_gui():
-    global parent_conn
-    global conn_lock
-    global process
-    with conn_lock:
-        parent_conn.send("quit")
-    process.join()
\ No newline at end of file
+    # Forwarder sends quit to the GUI process after the remaining messages.
+    # No join here, C++ shutdown waits for the thread and the process with
+    # a deadline.
+    status_queue.close()
+    print('GUI queue: max depth {}, coalesced {}'.format(
+        status_queue.max_depth, status_queue.coalesced))
\ No newline at end of file
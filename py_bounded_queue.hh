@@ -0,0 +1,292 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#pragma once
+
+#include <pybind11/embed.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "py_multithread_helpers.hh"
+
+// Bounded queue between C++ producers and Python consumers.
+//
+// Unbounded channels (such as multiprocessing.Pipe in ex9) make producers
+// block unpredictably when the consumer falls behind. This queue has a fixed
+// capacity and an overflow policy which decides what happens when it is full.
+// C++ side never needs the GIL and Python side releases the GIL while it is
+// waiting, so a slow consumer does not stall other threads.
+//
+// Python module is registered with RegisterBoundedQueueModule(), see
+// ex12_bounded_queue.cpp.
+
+enum class OverflowPolicy {
+    /// Producer waits until there is space
+    Block,
+    /// Oldest queued item is dropped to make space
+    DropOldest,
+    /// New item is dropped
+    DropNewest,
+    /// New item replaces the newest queued item
+    CoalesceLatest,
+};
+
+template <typename T>
+class BoundedQueue {
+ public:
+    struct Stats {
+        std::size_t depth;
+        std::size_t max_depth;
+        std::size_t pushed;
+        std::size_t popped;
+        std::size_t dropped;
+        std::size_t coalesced;
+    };
+
+    BoundedQueue(std::size_t capacity, OverflowPolicy policy)
+        :
+        capacity_(capacity > 0 ? capacity : 1),
+        policy_(policy)
+    {}
+
+    /// Push item to the queue. With OverflowPolicy::Block waits until there is
+    /// space, otherwise never blocks.
+    /// Returns false if the item was dropped or the queue is closed.
+    bool Push(T item) {
+        return Push(std::move(item), std::chrono::steady_clock::time_point::max());
+    }
+
+    /// Same as Push(T), but with OverflowPolicy::Block gives up after
+    /// `timeout`. Item is then counted as dropped.
+    template <typename Rep, typename Period>
+    bool Push(T item, const std::chrono::duration<Rep, Period> &timeout) {
+        return Push(std::move(item), Deadline(timeout));
+    }
+
+    /// Wait until an item is available.
+    /// Returns false if the queue has been closed and all items consumed.
+    bool Pop(T &out) {
+        return Pop(out, std::chrono::steady_clock::time_point::max());
+    }
+
+    /// Same as Pop(T&), but also returns false after `timeout`.
+    template <typename Rep, typename Period>
+    bool Pop(T &out, const std::chrono::duration<Rep, Period> &timeout) {
+        return Pop(out, Deadline(timeout));
+    }
+
+    /// Wake up all waiters. Further pushes fail, remaining items can still
+    /// be popped.
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    bool IsClosed() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_;
+    }
+
+    std::size_t Capacity() const { return capacity_; }
+    OverflowPolicy Policy() const { return policy_; }
+
+    Stats GetStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{items_.size(), max_depth_, pushed_, popped_, dropped_, coalesced_};
+    }
+ private:
+    using Clock = std::chrono::steady_clock;
+
+    template <typename Rep, typename Period>
+    static Clock::time_point Deadline(const std::chrono::duration<Rep, Period> &timeout) {
+        // Avoid overflow with very long timeouts
+        const auto remaining = Clock::time_point::max() - Clock::now();
+        if (timeout >= remaining) {
+            return Clock::time_point::max();
+        }
+        return Clock::now() + std::chrono::duration_cast<Clock::duration>(timeout);
+    }
+
+    bool Push(T item, Clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (closed_) {
+            return false;
+        }
+
+        if (items_.size() >= capacity_) {
+            switch (policy_) {
+                case OverflowPolicy::Block: {
+                    const auto has_space = [this]() { return closed_ || items_.size() < capacity_; };
+                    if (deadline == Clock::time_point::max()) {
+                        not_full_.wait(lock, has_space);
+                    } else if (!not_full_.wait_until(lock, deadline, has_space)) {
+                        ++dropped_;
+                        return false;
+                    }
+                    if (closed_) {
+                        return false;
+                    }
+                    break;
+                }
+                case OverflowPolicy::DropOldest:
+                    items_.pop_front();
+                    ++dropped_;
+                    break;
+                case OverflowPolicy::DropNewest:
+                    ++dropped_;
+                    return false;
+                case OverflowPolicy::CoalesceLatest:
+                    items_.back() = std::move(item);
+                    ++coalesced_;
+                    return true;
+            }
+        }
+
+        items_.push_back(std::move(item));
+        ++pushed_;
+        if (items_.size() > max_depth_) {
+            max_depth_ = items_.size();
+        }
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool Pop(T &out, Clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const auto has_item = [this]() { return closed_ || !items_.empty(); };
+        if (deadline == Clock::time_point::max()) {
+            not_empty_.wait(lock, has_item);
+        } else if (!not_empty_.wait_until(lock, deadline, has_item)) {
+            return false;
+        }
+        if (items_.empty()) {
+            // Closed
+            return false;
+        }
+
+        out = std::move(items_.front());
+        items_.pop_front();
+        ++popped_;
+        lock.unlock();
+        not_full_.notify_one();
+        return true;
+    }
+ private:
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+    const std::size_t capacity_;
+    const OverflowPolicy policy_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    bool closed_{false};
+    std::size_t max_depth_{0};
+    std::size_t pushed_{0};
+    std::size_t popped_{0};
+    std::size_t dropped_{0};
+    std::size_t coalesced_{0};
+};
+
+/// Close `queue` when PythonEnvironment::Shutdown() starts, so that Python
+/// consumers blocked in get() wake up and exit before the deadline.
+template <typename T>
+void CloseOnShutdown(const std::shared_ptr<BoundedQueue<T>> &queue) {
+    std::weak_ptr<BoundedQueue<T>> weak = queue;
+    PythonEnvironment::GetInstance().AddDrainHook([weak]() {
+        if (auto q = weak.lock()) {
+            q->Close();
+        }
+    });
+}
+
+using StringQueue = BoundedQueue<std::string>;
+
+/// Define Python module contents. Call from exactly one
+/// PYBIND11_EMBEDDED_MODULE(bounded_queue, m) in the application.
+inline void RegisterBoundedQueueModule(pybind11::module_ &m) {
+    namespace py = pybind11;
+
+    py::enum_<OverflowPolicy>(m, "OverflowPolicy")
+        .value("BLOCK", OverflowPolicy::Block)
+        .value("DROP_OLDEST", OverflowPolicy::DropOldest)
+        .value("DROP_NEWEST", OverflowPolicy::DropNewest)
+        .value("COALESCE_LATEST", OverflowPolicy::CoalesceLatest);
+
+    // Timeouts are given in seconds, None waits forever.
+    // GIL is released only around the wait, Python objects are converted
+    // while holding it.
+    py::class_<StringQueue, std::shared_ptr<StringQueue>>(m, "StringQueue")
+        .def(py::init<std::size_t, OverflowPolicy>(),
+             py::arg("capacity"), py::arg("policy") = OverflowPolicy::Block)
+        .def("put", [](StringQueue &q, std::string item, py::object timeout) {
+            if (timeout.is_none()) {
+                py::gil_scoped_release release;
+                return q.Push(std::move(item));
+            }
+            const std::chrono::duration<double> wait(timeout.cast<double>());
+            py::gil_scoped_release release;
+            return q.Push(std::move(item), wait);
+        }, py::arg("item"), py::arg("timeout") = py::none(),
+           "Returns False if the item was dropped or the queue is closed")
+        .def("get", [](StringQueue &q, py::object timeout) -> py::object {
+            std::string item;
+            bool ok;
+            if (timeout.is_none()) {
+                py::gil_scoped_release release;
+                ok = q.Pop(item);
+            } else {
+                const std::chrono::duration<double> wait(timeout.cast<double>());
+                py::gil_scoped_release release;
+                ok = q.Pop(item, wait);
+            }
+            if (!ok) {
+                return py::none();
+            }
+            return py::str(item);
+        }, py::arg("timeout") = py::none(),
+           "Returns None on timeout or when the queue is closed and empty")
+        .def("close", &StringQueue::Close)
+        .def_property_readonly("closed", &StringQueue::IsClosed)
+        .def_property_readonly("capacity", &StringQueue::Capacity)
+        .def_property_readonly("policy", &StringQueue::Policy)
+        .def_property_readonly("depth", [](const StringQueue &q) { return q.GetStats().depth; })
+        .def_property_readonly("max_depth", [](const StringQueue &q) { return q.GetStats().max_depth; })
+        .def_property_readonly("dropped", [](const StringQueue &q) { return q.GetStats().dropped; })
+        .def_property_readonly("coalesced", [](const StringQueue &q) { return q.GetStats().coalesced; });
+}
@@ -0,0 +1,320 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#pragma once
+
+#include <pybind11/embed.h>
+#include <pybind11/stl.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+#include "py_multithread_helpers.hh"
+
+// Result cache for pure Python functions which are called from many C++ threads.
+//
+// Every call to Python costs a GIL acquisition. When many threads call the same
+// pure function (no side effects, result depends only on the arguments) with the
+// same arguments, the result can be served from C++ without touching the GIL.
+// Concurrent identical calls are coalesced so that only one of them executes
+// the Python function while the others wait for its result.
+
+namespace call_cache_detail {
+
+inline void HashCombine(std::size_t &seed, std::size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+template <typename T>
+std::size_t HashValue(const T &value) {
+    return std::hash<T>()(value);
+}
+
+template <typename T>
+std::size_t HashValue(const std::vector<T> &values) {
+    std::size_t seed = values.size();
+    for (const auto &v : values) {
+        HashCombine(seed, HashValue(v));
+    }
+    return seed;
+}
+
+template <typename Tuple, std::size_t... I>
+std::size_t HashTuple(const Tuple &t, std::index_sequence<I...>) {
+    std::size_t seed = 0;
+    // Expand in order using initializer list
+    int unused[] = {0, (HashCombine(seed, HashValue(std::get<I>(t))), 0)...};
+    (void)unused;
+    return seed;
+}
+
+} // namespace call_cache_detail
+
+/// Cache for results of pure Python functions with signature Result(Args...).
+/// Arguments must be hashable (std::hash or std::vector of hashable) and
+/// comparable with ==. Result must be castable from Python by pybind11.
+template <typename Result, typename... Args>
+class PythonCallCache {
+ public:
+    struct Options {
+        /// Number of independently locked shards
+        std::size_t shards = 16;
+        /// Maximum number of cached results per shard. Least recently used
+        /// results are evicted first.
+        std::size_t capacity_per_shard = 1024;
+        /// How long a result is valid. Zero means forever.
+        std::chrono::milliseconds ttl{0};
+    };
+
+    struct Stats {
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t coalesced;
+        std::size_t evictions;
+    };
+
+    /// Handle to a function which has been marked as pure.
+    /// Only functions marked pure can be called through the cache.
+    class PureFunction {
+     public:
+        const std::string &Module() const { return module_; }
+        const std::string &Function() const { return function_; }
+     private:
+        friend class PythonCallCache;
+        PureFunction(std::size_t id, std::string module, std::string function)
+            :
+            id_(id),
+            module_(std::move(module)),
+            function_(std::move(function))
+        {}
+        std::size_t id_;
+        std::string module_;
+        std::string function_;
+    };
+
+    PythonCallCache()
+        :
+        PythonCallCache(Options())
+    {}
+
+    explicit PythonCallCache(const Options &options)
+        :
+        options_(options),
+        shards_(options.shards > 0 ? options.shards : 1)
+    {
+        if (options_.capacity_per_shard == 0) {
+            options_.capacity_per_shard = 1;
+        }
+    }
+
+    /// Mark Python function `module.function` as pure.
+    /// Does not need GIL, Python module is imported on first cache miss.
+    PureFunction MarkPure(std::string module, std::string function) {
+        return PureFunction(next_id_++, std::move(module), std::move(function));
+    }
+
+    /// Call pure function or return cached result.
+    /// Must be called without holding the GIL, `thread_state` is locked only
+    /// if the function needs to be executed.
+    /// After PythonEnvironment::Shutdown() has started, cached results are
+    /// still returned but misses throw. Executing misses hold the GIL lock,
+    /// so shutdown waits for them.
+    Result Call(PythonThreadState &thread_state, const PureFunction &function, const Args &... args) {
+        Key key(function.id_, args...);
+        if (!(key == key)) {
+            // Key which is not equal to itself (NaN argument) could never be
+            // found again, so its entry would never become ready or be evicted
+            ++misses_;
+            return Execute(thread_state, function, args...);
+        }
+        const std::size_t hash = KeyHash()(key);
+        Shard &shard = shards_[hash % shards_.size()];
+
+        std::unique_ptr<std::promise<Result>> promise;
+        Entry *entry = nullptr;
+        {
+            std::unique_lock<std::mutex> guard(shard.mutex);
+            auto it = shard.entries.find(key);
+            if (it != shard.entries.end() && IsExpired(it->second)) {
+                shard.lru.erase(it->second.lru_it);
+                shard.entries.erase(it);
+                it = shard.entries.end();
+            }
+            if (it != shard.entries.end()) {
+                // Move to front of LRU list
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_it);
+                auto result = it->second.result;
+                const bool ready = it->second.ready;
+                guard.unlock();
+
+                if (ready) {
+                    ++hits_;
+                } else {
+                    // Same call is already executing in another thread,
+                    // wait for it without holding the GIL.
+                    ++coalesced_;
+                }
+                return result.get();
+            }
+
+            ++misses_;
+            promise.reset(new std::promise<Result>());
+            Entry new_entry;
+            new_entry.result = promise->get_future().share();
+            shard.lru.push_front(key);
+            new_entry.lru_it = shard.lru.begin();
+            // References to map values survive rehashing, and entries which
+            // are not ready are never evicted or cleared
+            entry = &shard.entries.emplace(key, std::move(new_entry)).first->second;
+            EvictIfNeeded(shard);
+        }
+
+        try {
+            Result result = Execute(thread_state, function, args...);
+            promise->set_value(result);
+            MarkReady(shard, *entry);
+            return result;
+        } catch (...) {
+            // Failed calls are not cached, waiters receive the same exception
+            promise->set_exception(std::current_exception());
+            Erase(shard, *entry);
+            throw;
+        }
+    }
+
+    /// Remove all cached results. Calls which are in flight finish normally.
+    void Clear() {
+        for (auto &shard : shards_) {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+                if (it->second.ready) {
+                    shard.lru.erase(it->second.lru_it);
+                    it = shard.entries.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    Stats GetStats() const {
+        return Stats{hits_.load(), misses_.load(), coalesced_.load(), evictions_.load()};
+    }
+ private:
+    using Key = std::tuple<std::size_t, typename std::decay<Args>::type...>;
+    using Clock = std::chrono::steady_clock;
+
+    struct KeyHash {
+        std::size_t operator()(const Key &key) const {
+            return call_cache_detail::HashTuple(key, std::make_index_sequence<std::tuple_size<Key>::value>());
+        }
+    };
+
+    struct Entry {
+        std::shared_future<Result> result;
+        typename std::list<Key>::iterator lru_it;
+        Clock::time_point created;
+        bool ready{false};
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, Entry, KeyHash> entries;
+        // Most recently used first
+        std::list<Key> lru;
+    };
+
+    Result Execute(PythonThreadState &thread_state, const PureFunction &function, const Args &... args) {
+        auto lock = thread_state.GetLock(); // Lock GIL
+        try {
+            pybind11::module_ module = pybind11::module_::import(function.module_.c_str());
+            pybind11::object result = module.attr(function.function_.c_str())(args...);
+            return result.template cast<Result>();
+        } catch (const pybind11::error_already_set &e) {
+            // Python exception object must not outlive the GIL, so convert it
+            // to a plain C++ exception here.
+            throw std::runtime_error(e.what());
+        }
+    }
+
+    bool IsExpired(const Entry &entry) const {
+        return entry.ready && options_.ttl.count() > 0 &&
+            Clock::now() - entry.created > options_.ttl;
+    }
+
+    void MarkReady(Shard &shard, Entry &entry) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        entry.ready = true;
+        entry.created = Clock::now();
+    }
+
+    void Erase(Shard &shard, Entry &entry) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        // Call() only inserts keys which are equal to themselves
+        const auto lru_it = entry.lru_it;
+        shard.entries.erase(*lru_it);
+        shard.lru.erase(lru_it);
+    }
+
+    /// Shard mutex must be locked
+    void EvictIfNeeded(Shard &shard) {
+        auto it = shard.lru.end();
+        while (shard.entries.size() > options_.capacity_per_shard && it != shard.lru.begin()) {
+            --it;
+            auto entry = shard.entries.find(*it);
+            if (!entry->second.ready) {
+                // Never evict calls which are still executing
+                continue;
+            }
+            it = shard.lru.erase(it);
+            shard.entries.erase(entry);
+            ++evictions_;
+        }
+    }
+ private:
+    PythonCallCache(const PythonCallCache &) = delete;
+    PythonCallCache &operator=(const PythonCallCache &) = delete;
+    Options options_;
+    std::vector<Shard> shards_;
+    std::atomic<std::size_t> next_id_{0};
+    std::atomic<std::size_t> hits_{0};
+    std::atomic<std::size_t> misses_{0};
+    std::atomic<std::size_t> coalesced_{0};
+    std::atomic<std::size_t> evictions_{0};
+};
@@ -30,7 +30,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  #pragma once
 
 #include <pybind11/embed.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 
 // Compatibility macros for different Python versions
 #if PY_VERSION_HEX < 0x03020000
@@ -57,6 +66,70 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // Helper classes for Python >= 3.3
 
+/// Keeps track of threads which are using Python so that shutdown can stop
+/// new GIL acquisitions and wait for the ongoing ones to finish.
+class PythonShutdownGate {
+ public:
+    static PythonShutdownGate& GetInstance()
+    {
+        static PythonShutdownGate instance;
+        return instance;
+    }
+
+    /// Register start of Python use. Returns false if shutdown has started.
+    bool Enter() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return false;
+        }
+        ++active_;
+        return true;
+    }
+
+    void Leave() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --active_;
+        }
+        idle_.notify_all();
+    }
+
+    void Stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+
+    /// Wait until nobody is using Python. Returns false on timeout.
+    bool WaitIdle(std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return idle_.wait_until(lock, deadline, [this]() { return active_ == 0; });
+    }
+
+    bool IsStopping() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stopping_;
+    }
+
+    void SetFinalized() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finalized_ = true;
+    }
+
+    bool IsFinalized() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return finalized_;
+    }
+ private:
+    PythonShutdownGate() = default;
+    PythonShutdownGate(const PythonShutdownGate &) = delete;
+    PythonShutdownGate &operator=(const PythonShutdownGate &) = delete;
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::size_t active_{0};
+    bool stopping_{false};
+    bool finalized_{false};
+};
+
 // PyThreadSafe is interpreter and thread specific object.
 // It should not be used from other threads.
 class PythonThreadState {
@@ -84,11 +157,18 @@ class PythonThreadState {
     /// Lock GIL
     /// Returned Lock object must be kept alive during any pybind11 / Python method calls
     std::unique_ptr<Lock> GetLock() {
+        if (PythonShutdownGate::GetInstance().IsStopping()) {
+            throw std::runtime_error("Python is shutting down");
+        }
         CheckThread();
         return std::unique_ptr<Lock>(new Lock(state_, was_new_));
     }
 
     ~PythonThreadState() {
+        if (PythonShutdownGate::GetInstance().IsFinalized()) {
+            // Finalization already deleted the thread state
+            return;
+        }
         CheckThread();
 
         if (!was_new_ || !state_) {
@@ -102,17 +182,25 @@ class PythonThreadState {
             return;
         }
 
+        auto &gate = PythonShutdownGate::GetInstance();
+        if (!gate.Enter()) {
+            // Shutdown has started and may be holding the GIL. Finalization
+            // deletes all remaining thread states of the interpreter.
+            return;
+        }
+
         // For new thread states, we need to properly clean up
         // We need to make this thread state current to clean it up
-        PyThreadState* old_state = PyThreadState_Swap(state_);
+        PyEval_AcquireThread(state_);
 
-        // Clear and destroy
+        // Clear and destroy, also releases the GIL
         PyThreadState_Clear(state_);
         PyThreadState_DeleteCurrent();
 
         // Note: We can't restore the old state after DeleteCurrent
         // The thread now has no associated thread state
         state_ = nullptr;
+        gate.Leave();
     }
  private:
     /// Ensure that current thread is the same one which created this object
@@ -133,12 +221,16 @@ class PythonThreadState {
             ts_(ts),
             was_new_(was_new)
         {
-            if (!ts_ || Py_IsFinalizing()) {
+            if (!ts_ || Py_IsFinalizing() || PythonShutdownGate::GetInstance().IsFinalized()) {
                 // No thread state or Python is finalizing, don't acquire
                 ts_ = nullptr;
                 return;
             }
 
+            if (!PythonShutdownGate::GetInstance().Enter()) {
+                throw std::runtime_error("Python is shutting down");
+            }
+
             // Get GIL
             if (!was_new) {
                 PyEval_RestoreThread(ts_);
@@ -148,12 +240,15 @@ class PythonThreadState {
         }
 
         ~Lock() {
-            if (!ts_ || Py_IsFinalizing()) {
+            if (!ts_) {
                 return;
             }
 
-            // Release GIL
-            PyEval_ReleaseThread(ts_);
+            if (!Py_IsFinalizing()) {
+                // Release GIL
+                PyEval_ReleaseThread(ts_);
+            }
+            PythonShutdownGate::GetInstance().Leave();
         }
      private:
         Lock(const Lock &) = delete;
@@ -171,25 +266,127 @@ class PythonThreadState {
     bool was_new_{false};
 };
 
+/// Time spent in each phase of PythonEnvironment::Shutdown()
+struct PythonShutdownReport {
+    /// Waiting for background initialization, before the phases
+    std::chrono::microseconds init_wait{0};
+    std::chrono::microseconds stop_acquisitions{0};
+    std::chrono::microseconds drain{0};
+    std::chrono::microseconds stop_workers{0};
+    std::chrono::microseconds finalize{0};
+    std::chrono::microseconds total{0};
+    /// All threads released the GIL before the deadline
+    bool drained{false};
+    /// Python threads and child processes exited before the deadline
+    bool workers_stopped{false};
+    bool finalized{false};
+    std::vector<std::string> errors;
+
+    std::string ToString() const {
+        std::ostringstream out;
+        out << "Shutdown took " << total.count() << " us"
+            << " (init wait " << init_wait.count() << " us"
+            << ", stop " << stop_acquisitions.count() << " us"
+            << ", drain " << drain.count() << " us"
+            << ", stop workers " << stop_workers.count() << " us"
+            << ", finalize " << finalize.count() << " us)"
+            << ", drained: " << (drained ? "yes" : "no")
+            << ", workers stopped: " << (workers_stopped ? "yes" : "no")
+            << ", finalized: " << (finalized ? "yes" : "no");
+        for (const auto &e : errors) {
+            out << std::endl << "  " << e;
+        }
+        return out.str();
+    }
+};
+
+/// Startup timing of PythonEnvironment
+struct PythonInitMetrics {
+    /// Interpreter initialization
+    std::chrono::microseconds init{0};
+    /// Setup code and warm-up imports
+    std::chrono::microseconds warm_up{0};
+    /// From start of initialization until first CreateThreadState() returned
+    std::chrono::microseconds time_to_first_call{0};
+    /// How long the first CreateThreadState() call waited for initialization
+    std::chrono::microseconds first_call_wait{0};
+    bool background{false};
+    bool first_call_done{false};
+    std::vector<std::string> errors;
+
+    std::string ToString() const {
+        std::ostringstream out;
+        out << "Python init " << init.count() << " us"
+            << ", warm-up " << warm_up.count() << " us"
+            << (background ? " (background)" : "");
+        if (first_call_done) {
+            out << ", time to first call " << time_to_first_call.count() << " us"
+                << ", first call waited " << first_call_wait.count() << " us";
+        }
+        for (const auto &e : errors) {
+            out << std::endl << "  " << e;
+        }
+        return out.str();
+    }
+};
+
+/// Options for PythonEnvironment::StartBackgroundInit()
+struct PythonBackgroundInitOptions {
+    /// Python code executed after initialization, for example to setup sys.path.
+    /// Indentation common to all lines is removed, so indented raw string
+    /// literals can be used.
+    std::string setup_code;
+    /// Modules which are imported after setup code
+    std::vector<std::string> warm_imports;
+};
+
 /// This class initializes the Python environment.
 class PythonEnvironment {
  public:
+    /// Default deadline for shutdown from the destructor
+    static std::chrono::milliseconds DefaultShutdownTimeout() {
+        return std::chrono::milliseconds(5000);
+    }
+
     static PythonEnvironment& GetInstance()
     {
         static PythonEnvironment instance;
         return instance;
     }
 
+    /// Start initializing Python on a background thread and return immediately.
+    /// Must be called once, before anything else uses PythonEnvironment,
+    /// otherwise throws std::runtime_error. The background thread stays alive
+    /// and is seen by Python as its main thread, the interpreter is also
+    /// finalized from it.
+    static void StartBackgroundInit(const PythonBackgroundInitOptions &options) {
+        {
+            auto &config = GetInitConfig();
+            std::lock_guard<std::mutex> lock(config.mutex);
+            if (config.instance_created || config.background) {
+                throw std::runtime_error("PythonEnvironment has already been initialized");
+            }
+            config.background = true;
+            config.options = options;
+        }
+        GetInstance();
+    }
+
     PyInterpreterState* GetInterpreter() {
+        WaitUntilReady();
         // Global state of Python interpreter.
         // We could have sub interpreters, which kinda have their own environment,
         // but let's use just one so module loading is faster.
         return ts_ ? ts_->interp : nullptr;
     }
 
+    /// Blocks if initialization is still running on the background thread.
     std::unique_ptr<PythonThreadState> CreateThreadState()
     {
-        if (Py_IsFinalizing() || !ts_) {
+        const auto wait = WaitUntilReady();
+        RecordFirstCall(wait);
+
+        if (Py_IsFinalizing() || !ts_ || PythonShutdownGate::GetInstance().IsStopping()) {
             // Python is finalizing or not initialized
             return nullptr;
         }
@@ -203,12 +400,272 @@ class PythonEnvironment {
         auto out = std::unique_ptr<PythonThreadState>(new PythonThreadState(GetInterpreter()));
         return out;
     }
+
+    PythonInitMetrics GetInitMetrics() const {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        return metrics_;
+    }
+
+    /// Add function which is called with GIL locked when shutdown starts.
+    /// Use it to tell Python threads and child processes to stop.
+    void AddShutdownHook(std::function<void()> hook) {
+        std::lock_guard<std::mutex> lock(hooks_mutex_);
+        shutdown_hooks_.push_back(std::move(hook));
+    }
+
+    /// Add function which is called without the GIL before shutdown waits
+    /// for GIL users. Use it to wake up threads which wait for C++ while
+    /// holding a lock, for example by closing a BoundedQueue
+    /// (see CloseOnShutdown() in py_bounded_queue.hh).
+    void AddDrainHook(std::function<void()> hook) {
+        std::lock_guard<std::mutex> lock(hooks_mutex_);
+        drain_hooks_.push_back(std::move(hook));
+    }
+
+    /// Stop Python within `timeout`:
+    /// 1. New GIL acquisitions fail (GetLock() throws, CreateThreadState() returns nullptr)
+    /// 2. Run drain hooks and wait for threads holding or waiting for the
+    ///    GIL to finish. This includes PythonCallCache misses which are
+    ///    executing, other threads waiting for the same result get the
+    ///    exception of the refused GetLock().
+    /// 3. Run shutdown hooks, wait for Python threads and child processes,
+    ///    and terminate child processes which are still running
+    /// 4. Finalize the interpreter
+    /// If a phase does not finish in time, rest of the phases are skipped and
+    /// the interpreter is left running instead of hanging. If threads did not
+    /// release the GIL in time, Shutdown() can be called again.
+    /// With background initialization phases 3 and 4 are run on the thread
+    /// which initialized Python, otherwise on the calling thread using the
+    /// thread state of the thread which initialized Python.
+    /// Background initialization is always waited to finish. Concurrent
+    /// calls wait for the first one, which does the shutdown.
+    PythonShutdownReport Shutdown(std::chrono::milliseconds timeout) {
+        PythonShutdownReport report;
+        const auto start = Clock::now();
+        const auto deadline = start + timeout;
+        report.init_wait = WaitUntilReady();
+
+        std::lock_guard<std::mutex> shutdown_lock(shutdown_mutex_);
+        auto phase_start = Clock::now();
+        auto &gate = PythonShutdownGate::GetInstance();
+        if (!ts_) {
+            report.errors.push_back("Python is not initialized");
+            return report;
+        }
+        if (shutdown_finished_ || Py_IsFinalizing()) {
+            report.errors.push_back("Shutdown already done");
+            return report;
+        }
+        // Earlier call may have given up waiting for GIL users, then
+        // acquisitions are already stopped and this call retries draining.
+        gate.Stop();
+        EndPhase(phase_start, report.stop_acquisitions);
+
+        std::vector<std::function<void()>> drain_hooks;
+        {
+            std::lock_guard<std::mutex> lock(hooks_mutex_);
+            drain_hooks.swap(drain_hooks_);
+        }
+        for (auto &hook : drain_hooks) {
+            try {
+                hook();
+            } catch (const std::exception &e) {
+                report.errors.push_back(e.what());
+            }
+        }
+        report.drained = gate.WaitIdle(deadline);
+        EndPhase(phase_start, report.drain);
+        if (!report.drained) {
+            // Background init thread stays parked, its thread state is
+            // still used by the interpreter. Shutdown() can be retried.
+            report.errors.push_back("Threads did not release the GIL in time");
+            report.total = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+            return report;
+        }
+
+        shutdown_finished_ = true;
+        const auto finish = [&]() { FinishShutdown(deadline, phase_start, report); };
+        if (init_thread_.joinable()) {
+            RunOnInitThread(finish);
+        } else {
+            finish();
+        }
+
+        report.total = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+        return report;
+    }
  private:
-    PythonEnvironment() :
-        ts_(nullptr),
-        thread_id_(std::this_thread::get_id()),
-        initialized_(false)
-    {
+    using Clock = std::chrono::steady_clock;
+
+    static void EndPhase(Clock::time_point &phase_start, std::chrono::microseconds &out) {
+        const auto now = Clock::now();
+        out = std::chrono::duration_cast<std::chrono::microseconds>(now - phase_start);
+        phase_start = now;
+    }
+
+    struct InitConfig {
+        std::mutex mutex;
+        bool instance_created{false};
+        bool background{false};
+        PythonBackgroundInitOptions options;
+    };
+
+    static InitConfig &GetInitConfig() {
+        static InitConfig config;
+        return config;
+    }
+
+    /// Phases 3 and 4 of Shutdown()
+    void FinishShutdown(Clock::time_point deadline, Clock::time_point &phase_start,
+                        PythonShutdownReport &report) {
+        // Nobody else can lock the GIL anymore, so thread state of the thread
+        // which initialized Python can be used from this thread. Finalizing
+        // with it works like finalizing on that thread.
+        const bool owner_thread = thread_id_ == std::this_thread::get_id();
+        const bool main_state = owner_thread || initialized_;
+        PyThreadState *ts = main_state ? ts_ : PyThreadState_New(GetInterpreter());
+        PyEval_RestoreThread(ts);
+
+        std::vector<std::function<void()>> hooks;
+        {
+            std::lock_guard<std::mutex> lock(hooks_mutex_);
+            hooks.swap(shutdown_hooks_);
+        }
+        for (auto &hook : hooks) {
+            try {
+                hook();
+            } catch (const std::exception &e) {
+                report.errors.push_back(e.what());
+            }
+        }
+        report.workers_stopped = StopPythonWorkers(deadline, report.errors);
+        EndPhase(phase_start, report.stop_workers);
+
+        if (initialized_ && report.workers_stopped) {
+            // Threads which are still alive would make finalization hang
+            pybind11::finalize_interpreter();
+            PythonShutdownGate::GetInstance().SetFinalized();
+            report.finalized = true;
+        } else {
+            if (main_state) {
+                PyEval_SaveThread();
+            } else {
+                PyThreadState_Clear(ts);
+                PyThreadState_DeleteCurrent();
+            }
+        }
+        EndPhase(phase_start, report.finalize);
+    }
+
+    /// Wait for non-daemon Python threads and child processes started with
+    /// multiprocessing. Child processes which do not exit in time are
+    /// terminated. GIL must be locked.
+    /// Returns true if no non-daemon threads are left.
+    static bool StopPythonWorkers(std::chrono::steady_clock::time_point deadline,
+                                  std::vector<std::string> &errors) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::duration<double>>(
+            deadline - std::chrono::steady_clock::now());
+        try {
+            pybind11::dict scope;
+            scope["timeout"] = remaining.count() > 0.0 ? remaining.count() : 0.0;
+            pybind11::exec(R"(
+                import sys, threading, time
+                deadline = time.monotonic() + timeout
+                def left():
+                    return max(0.0, deadline - time.monotonic())
+
+                # Don't import multiprocessing if nobody has used it
+                mp = sys.modules.get('multiprocessing')
+                if mp is not None:
+                    for p in mp.active_children():
+                        p.join(left())
+                        if p.is_alive():
+                            p.terminate()
+                            p.join(0.1)
+
+                current = threading.current_thread()
+                for t in threading.enumerate():
+                    if t is current or t is threading.main_thread() or t.daemon:
+                        continue
+                    t.join(left())
+
+                stopped = not any(t.is_alive() and not t.daemon
+                                  for t in threading.enumerate()
+                                  if t is not current and t is not threading.main_thread())
+            )", scope);
+            return scope["stopped"].cast<bool>();
+        } catch (const std::exception &e) {
+            errors.push_back(e.what());
+            return false;
+        }
+    }
+
+    /// Returns time spent waiting
+    std::chrono::microseconds WaitUntilReady() const {
+        const auto start = Clock::now();
+        std::unique_lock<std::mutex> lock(ready_mutex_);
+        if (ready_) {
+            return std::chrono::microseconds(0);
+        }
+        ready_cv_.wait(lock, [this]() { return ready_; });
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    }
+
+    void RecordFirstCall(std::chrono::microseconds wait) {
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        if (metrics_.first_call_done) {
+            return;
+        }
+        metrics_.first_call_done = true;
+        metrics_.first_call_wait = wait;
+        metrics_.time_to_first_call = std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - init_start_);
+    }
+
+    /// Run `task` on the background init thread and wait for the thread to
+    /// exit. Does nothing without background init.
+    void RunOnInitThread(std::function<void()> task) {
+        if (!init_thread_.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex_);
+            init_thread_task_ = task ? std::move(task) : []() {};
+        }
+        ready_cv_.notify_all();
+        init_thread_.join();
+    }
+
+    void InitThreadMain(PythonBackgroundInitOptions options) {
+        // Exceptions would terminate the process. Record them instead,
+        // CreateThreadState() then returns nullptr if Python did not start.
+        try {
+            Initialize();
+            WarmUp(options);
+        } catch (const std::exception &e) {
+            std::lock_guard<std::mutex> lock(ready_mutex_);
+            metrics_.errors.push_back(e.what());
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(ready_mutex_);
+            metrics_.errors.push_back("Unknown exception during Python initialization");
+        }
+        SetReady();
+
+        // Keep the thread alive so that the interpreter can be finalized
+        // from the same thread which initialized it.
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(ready_mutex_);
+            ready_cv_.wait(lock, [this]() { return static_cast<bool>(init_thread_task_); });
+            task = std::move(init_thread_task_);
+        }
+        task();
+    }
+
+    void Initialize() {
+        const auto start = Clock::now();
+        thread_id_ = std::this_thread::get_id();
+
         // Check if Python is already initialized (might be in some embedded scenarios)
         if (Py_IsInitialized()) {
             ts_ = PyThreadState_Get();
@@ -240,16 +697,95 @@ class PythonEnvironment {
         if (ts_) {
             PyEval_ReleaseThread(ts_);
         }
+
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        metrics_.init = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    }
+
+    void WarmUp(const PythonBackgroundInitOptions &options) {
+        if (!ts_ || !initialized_ || (options.setup_code.empty() && options.warm_imports.empty())) {
+            return;
+        }
+        const auto start = Clock::now();
+        std::vector<std::string> errors;
+
+        PyEval_RestoreThread(ts_);
+        try {
+            if (!options.setup_code.empty()) {
+                // pybind11 removes common indentation only from string literals
+                pybind11::object dedent = pybind11::module_::import("textwrap").attr("dedent");
+                pybind11::exec(pybind11::str(dedent(options.setup_code)));
+            }
+        } catch (const std::exception &e) {
+            errors.push_back(e.what());
+        } catch (...) {
+            errors.push_back("Unknown exception in setup code");
+        }
+        for (const auto &name : options.warm_imports) {
+            try {
+                pybind11::module_::import(name.c_str());
+            } catch (const std::exception &e) {
+                errors.push_back(e.what());
+            } catch (...) {
+                errors.push_back("Unknown exception while importing " + name);
+            }
+        }
+        PyEval_SaveThread();
+
+        std::lock_guard<std::mutex> lock(ready_mutex_);
+        metrics_.warm_up = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+        metrics_.errors.insert(metrics_.errors.end(), errors.begin(), errors.end());
+    }
+
+    void SetReady() {
+        {
+            std::lock_guard<std::mutex> lock(ready_mutex_);
+            ready_ = true;
+        }
+        ready_cv_.notify_all();
+    }
+
+    PythonEnvironment() :
+        ts_(nullptr),
+        thread_id_(std::this_thread::get_id()),
+        initialized_(false),
+        init_start_(Clock::now())
+    {
+        // Construct the gate before this object so that it is destroyed
+        // after it. Destructor uses the gate for shutdown.
+        PythonShutdownGate::GetInstance();
+
+        bool background = false;
+        PythonBackgroundInitOptions options;
+        {
+            auto &config = GetInitConfig();
+            std::lock_guard<std::mutex> lock(config.mutex);
+            config.instance_created = true;
+            background = config.background;
+            options = config.options;
+        }
+        if (background) {
+            metrics_.background = true;
+            init_thread_ = std::thread(&PythonEnvironment::InitThreadMain, this, std::move(options));
+            return;
+        }
+
+        Initialize();
+        SetReady();
     }
 
     ~PythonEnvironment() {
-        // Only finalize if we initialized
-        if (initialized_ && ts_ && !Py_IsFinalizing()) {
-            PyEval_RestoreThread(ts_);
-            pybind11::finalize_interpreter();
-            // Or without pybind11
-            // Py_Finalize();
+        // Only finalize if we initialized and Shutdown() has not finished,
+        // also retries a Shutdown() which gave up waiting for GIL users
+        WaitUntilReady();
+        if (!shutdown_finished_ && initialized_ && ts_ && !Py_IsFinalizing()) {
+            // Shutdown uses pybind11::finalize_interpreter(), or without
+            // pybind11 Py_Finalize()
+            Shutdown(DefaultShutdownTimeout());
         }
+        // Background init thread is still parked if shutdown did not finish.
+        // Process is exiting, so let it end without finalizing.
+        RunOnInitThread(nullptr);
     }
 
  private:
@@ -259,4 +795,18 @@ class PythonEnvironment {
     PyThreadState* ts_;
     std::thread::id thread_id_;
     bool initialized_;  // Track if we initialized Python
+    std::mutex hooks_mutex_;
+    std::vector<std::function<void()>> shutdown_hooks_;
+    std::vector<std::function<void()>> drain_hooks_;
+    std::mutex shutdown_mutex_;
+    std::atomic<bool> shutdown_finished_{false};
+
+    // Initialization state, also protects metrics and background thread task
+    mutable std::mutex ready_mutex_;
+    mutable std::condition_variable ready_cv_;
+    bool ready_{false};
+    Clock::time_point init_start_;
+    PythonInitMetrics metrics_;
+    std::thread init_thread_;
+    std::function<void()> init_thread_task_;
 };
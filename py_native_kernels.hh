@@ -0,0 +1,457 @@
+/* Copyright (c) 2021 Matti Jukola <buq2@buq2.com>, All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+   may be used to endorse or promote products derived from this software
+   without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#pragma once
+
+#include <pybind11/embed.h>
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Native element-wise kernels which are defined from Python.
+//
+// Python code composes an expression from a small set of primitives and
+// registers it with a name:
+//
+//     import native_kernels as nk
+//     nk.register("sum", nk.reduce_sum(nk.add(nk.arg(0), nk.arg(1))))
+//
+// C++ threads look up the kernel once and run it without the GIL. Expression
+// is compiled into a flat list of instructions which are executed in small
+// blocks. Each instruction is a branch free loop over non-aliasing contiguous
+// memory, which the compiler vectorizes at -O3 for the instruction set it
+// targets (SSE2 by default on x86-64, NEON on AArch64, AVX2/AVX-512 with
+// -march). See NATIVE_KERNELS_ARCH in CMakeLists.txt.
+//
+// Python module is registered with RegisterModule(), see ex11_native_kernels.cpp.
+
+namespace native_kernels {
+
+enum class OpCode {
+    Arg,
+    Constant,
+    Add,
+    Mul,
+    Fma,  // a * b + c
+};
+
+enum class Reduction {
+    None,
+    Sum,
+    Min,
+    Max,
+};
+
+/// Expression node built from Python. Immutable after creation.
+struct Expr {
+    OpCode op{OpCode::Constant};
+    int arg_index{0};
+    double constant{0.0};
+    Reduction reduction{Reduction::None};
+    std::vector<std::shared_ptr<Expr>> operands;
+};
+
+using ExprPtr = std::shared_ptr<Expr>;
+
+/// Number of elements evaluated at a time. Scratch registers of one block
+/// should fit in L1 cache.
+const std::size_t kBlockSize = 256;
+
+// Reduction operations. Selected once per Reduce() call so that the
+// reduction loops have no branches.
+struct SumOp {
+    template <typename T>
+    static T Init(T) { return T(0); }
+    template <typename T>
+    static T Apply(T a, T b) { return a + b; }
+};
+
+struct MinOp {
+    template <typename T>
+    static T Init(T first) { return first; }
+    template <typename T>
+    static T Apply(T a, T b) { return b < a ? b : a; }
+};
+
+struct MaxOp {
+    template <typename T>
+    static T Init(T first) { return first; }
+    template <typename T>
+    static T Apply(T a, T b) { return a < b ? b : a; }
+};
+
+/// Compiled expression. Thread safe, does not need the GIL.
+class Kernel {
+ public:
+    explicit Kernel(const ExprPtr &expr) {
+        if (!expr) {
+            throw std::invalid_argument("Kernel expression is empty");
+        }
+        reduction_ = expr->reduction;
+        std::map<const Expr*, Operand> compiled;
+        result_ = Compile(*expr, compiled);
+    }
+
+    std::size_t NumInputs() const { return num_inputs_; }
+    bool IsReduction() const { return reduction_ != Reduction::None; }
+
+    /// Element-wise kernel: out[i] = expr(inputs[0][i], inputs[1][i], ...)
+    template <typename T>
+    void Map(const std::vector<const T*> &inputs, std::size_t n, T *out) const {
+        if (IsReduction()) {
+            throw std::logic_error("Kernel is a reduction, use Reduce()");
+        }
+        CheckInputs(inputs.size());
+        std::vector<T> regs = CreateRegisters<T>();
+        for (std::size_t offset = 0; offset < n; offset += kBlockSize) {
+            const std::size_t len = std::min(kBlockSize, n - offset);
+            const T *result = EvaluateBlock(inputs, offset, len, regs);
+            std::copy(result, result + len, out + offset);
+        }
+    }
+
+    /// Reduction kernel: reduce(expr(inputs[0][i], inputs[1][i], ...))
+    template <typename T>
+    T Reduce(const std::vector<const T*> &inputs, std::size_t n) const {
+        if (!IsReduction()) {
+            throw std::logic_error("Kernel is not a reduction, use Map()");
+        }
+        CheckInputs(inputs.size());
+        if (n == 0 && reduction_ != Reduction::Sum) {
+            throw std::invalid_argument("Min/max reduction of empty input");
+        }
+        switch (reduction_) {
+            case Reduction::Min:
+                return ReduceWith<MinOp>(inputs, n);
+            case Reduction::Max:
+                return ReduceWith<MaxOp>(inputs, n);
+            default:
+                return ReduceWith<SumOp>(inputs, n);
+        }
+    }
+ private:
+    // Operand refers either to an input array or to a scratch register
+    struct Operand {
+        bool is_input{false};
+        std::size_t index{0};
+    };
+
+    struct Instruction {
+        OpCode op;
+        std::size_t dst;
+        Operand a, b, c;
+    };
+
+    /// Subexpressions which are shared by several nodes are compiled only
+    /// once, `compiled` maps already compiled nodes to their results.
+    Operand Compile(const Expr &expr, std::map<const Expr*, Operand> &compiled) {
+        auto it = compiled.find(&expr);
+        if (it != compiled.end()) {
+            return it->second;
+        }
+        const Operand out = CompileNode(expr, compiled);
+        compiled.emplace(&expr, out);
+        return out;
+    }
+
+    Operand CompileNode(const Expr &expr, std::map<const Expr*, Operand> &compiled) {
+        Operand out;
+        switch (expr.op) {
+            case OpCode::Arg:
+                if (expr.arg_index < 0) {
+                    throw std::invalid_argument("Kernel argument index must be non-negative");
+                }
+                out.is_input = true;
+                out.index = static_cast<std::size_t>(expr.arg_index);
+                num_inputs_ = std::max(num_inputs_, out.index + 1);
+                return out;
+            case OpCode::Constant:
+                out.index = num_registers_++;
+                constants_.emplace_back(out.index, expr.constant);
+                return out;
+            case OpCode::Add:
+            case OpCode::Mul:
+            case OpCode::Fma:
+                break;
+        }
+
+        const std::size_t expected = expr.op == OpCode::Fma ? 3 : 2;
+        if (expr.operands.size() != expected) {
+            throw std::invalid_argument("Wrong number of operands in kernel expression");
+        }
+        Instruction ins;
+        ins.op = expr.op;
+        Operand *operands[] = {&ins.a, &ins.b, &ins.c};
+        for (std::size_t i = 0; i < expected; ++i) {
+            const auto &operand = expr.operands[i];
+            if (!operand) {
+                throw std::invalid_argument("Kernel expression operand is empty");
+            }
+            if (operand->reduction != Reduction::None) {
+                throw std::invalid_argument("Reductions are only allowed as the outermost operation");
+            }
+            *operands[i] = Compile(*operand, compiled);
+        }
+        ins.dst = num_registers_++;
+        out.index = ins.dst;
+        instructions_.push_back(ins);
+        return out;
+    }
+
+    void CheckInputs(std::size_t num_inputs) const {
+        if (num_inputs < num_inputs_) {
+            throw std::invalid_argument("Kernel needs " + std::to_string(num_inputs_) + " inputs");
+        }
+    }
+
+    template <typename T>
+    std::vector<T> CreateRegisters() const {
+        std::vector<T> regs(num_registers_ * kBlockSize);
+        for (const auto &c : constants_) {
+            std::fill_n(regs.begin() + c.first * kBlockSize, kBlockSize, static_cast<T>(c.second));
+        }
+        return regs;
+    }
+
+    template <typename T>
+    const T *Resolve(const Operand &op, const std::vector<const T*> &inputs,
+                     std::size_t offset, const std::vector<T> &regs) const {
+        if (op.is_input) {
+            return inputs[op.index] + offset;
+        }
+        return regs.data() + op.index * kBlockSize;
+    }
+
+    /// Returns pointer to `len` results of the expression
+    template <typename T>
+    const T *EvaluateBlock(const std::vector<const T*> &inputs, std::size_t offset,
+                           std::size_t len, std::vector<T> &regs) const {
+        for (const auto &ins : instructions_) {
+            T *d = regs.data() + ins.dst * kBlockSize;
+            const T *a = Resolve(ins.a, inputs, offset, regs);
+            const T *b = Resolve(ins.b, inputs, offset, regs);
+            switch (ins.op) {
+                case OpCode::Add:
+                    AddLoop(d, a, b, len);
+                    break;
+                case OpCode::Mul:
+                    MulLoop(d, a, b, len);
+                    break;
+                case OpCode::Fma:
+                    FmaLoop(d, a, b, Resolve(ins.c, inputs, offset, regs), len);
+                    break;
+                case OpCode::Arg:
+                case OpCode::Constant:
+                    break;
+            }
+        }
+        return Resolve(result_, inputs, offset, regs);
+    }
+
+    template <typename Op, typename T>
+    T ReduceWith(const std::vector<const T*> &inputs, std::size_t n) const {
+        if (n == 0) {
+            return T(0);
+        }
+        std::vector<T> regs = CreateRegisters<T>();
+
+        // One accumulator per block element. Combining a block into it is an
+        // element-wise loop, which vectorizes also for floating point min/max
+        // where a loop carried reduction would need -ffast-math.
+        std::vector<T> acc;
+        for (std::size_t offset = 0; offset < n; offset += kBlockSize) {
+            const std::size_t len = std::min(kBlockSize, n - offset);
+            const T *x = EvaluateBlock(inputs, offset, len, regs);
+            if (offset == 0) {
+                acc.assign(kBlockSize, Op::Init(x[0]));
+            }
+            AccumulateLoop<Op>(acc.data(), x, len);
+        }
+        T out = acc[0];
+        for (std::size_t i = 1; i < kBlockSize; ++i) {
+            out = Op::Apply(out, acc[i]);
+        }
+        return out;
+    }
+
+    template <typename Op, typename T>
+    static void AccumulateLoop(T *__restrict acc, const T *__restrict x, std::size_t len) {
+        for (std::size_t i = 0; i < len; ++i) {
+            acc[i] = Op::Apply(acc[i], x[i]);
+        }
+    }
+
+    // Destination register never aliases the operands
+    template <typename T>
+    static void AddLoop(T *__restrict d, const T *__restrict a, const T *__restrict b, std::size_t len) {
+        for (std::size_t i = 0; i < len; ++i) {
+            d[i] = a[i] + b[i];
+        }
+    }
+
+    template <typename T>
+    static void MulLoop(T *__restrict d, const T *__restrict a, const T *__restrict b, std::size_t len) {
+        for (std::size_t i = 0; i < len; ++i) {
+            d[i] = a[i] * b[i];
+        }
+    }
+
+    template <typename T>
+    static void FmaLoop(T *__restrict d, const T *__restrict a, const T *__restrict b,
+                        const T *__restrict c, std::size_t len) {
+        for (std::size_t i = 0; i < len; ++i) {
+            d[i] = a[i] * b[i] + c[i];
+        }
+    }
+ private:
+    Reduction reduction_{Reduction::None};
+    std::vector<Instruction> instructions_;
+    std::vector<std::pair<std::size_t, double>> constants_;
+    std::size_t num_registers_{0};
+    std::size_t num_inputs_{0};
+    Operand result_;
+};
+
+/// Named kernels registered from Python.
+class KernelRegistry {
+ public:
+    static KernelRegistry& GetInstance()
+    {
+        static KernelRegistry instance;
+        return instance;
+    }
+
+    void Register(const std::string &name, std::shared_ptr<const Kernel> kernel) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        kernels_[name] = std::move(kernel);
+    }
+
+    /// Returns nullptr if kernel has not been registered.
+    /// Returned kernel can be used without any locks.
+    std::shared_ptr<const Kernel> Find(const std::string &name) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = kernels_.find(name);
+        return it != kernels_.end() ? it->second : nullptr;
+    }
+ private:
+    KernelRegistry() = default;
+    KernelRegistry(const KernelRegistry &) = delete;
+    KernelRegistry &operator=(const KernelRegistry &) = delete;
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<const Kernel>> kernels_;
+};
+
+inline ExprPtr MakeArg(int index) {
+    auto e = std::make_shared<Expr>();
+    e->op = OpCode::Arg;
+    e->arg_index = index;
+    return e;
+}
+
+inline ExprPtr MakeConstant(double value) {
+    auto e = std::make_shared<Expr>();
+    e->op = OpCode::Constant;
+    e->constant = value;
+    return e;
+}
+
+inline ExprPtr MakeOp(OpCode op, std::vector<ExprPtr> operands) {
+    auto e = std::make_shared<Expr>();
+    e->op = op;
+    e->operands = std::move(operands);
+    return e;
+}
+
+inline ExprPtr MakeReduction(Reduction reduction, const ExprPtr &operand) {
+    if (!operand || operand->reduction != Reduction::None) {
+        throw std::invalid_argument("Reduction operand must be an element-wise expression");
+    }
+    // Reduction is stored on a copy of the outermost node
+    auto e = std::make_shared<Expr>(*operand);
+    e->reduction = reduction;
+    return e;
+}
+
+/// Define Python module contents. Call from exactly one
+/// PYBIND11_EMBEDDED_MODULE(native_kernels, m) in the application.
+inline void RegisterModule(pybind11::module_ &m) {
+    namespace py = pybind11;
+
+    py::class_<Expr, std::shared_ptr<Expr>>(m, "Expr")
+        .def("__add__", [](const ExprPtr &a, const ExprPtr &b) {
+            return MakeOp(OpCode::Add, {a, b});
+        })
+        .def("__add__", [](const ExprPtr &a, double b) {
+            return MakeOp(OpCode::Add, {a, MakeConstant(b)});
+        })
+        .def("__radd__", [](const ExprPtr &a, double b) {
+            return MakeOp(OpCode::Add, {MakeConstant(b), a});
+        })
+        .def("__mul__", [](const ExprPtr &a, const ExprPtr &b) {
+            return MakeOp(OpCode::Mul, {a, b});
+        })
+        .def("__mul__", [](const ExprPtr &a, double b) {
+            return MakeOp(OpCode::Mul, {a, MakeConstant(b)});
+        })
+        .def("__rmul__", [](const ExprPtr &a, double b) {
+            return MakeOp(OpCode::Mul, {MakeConstant(b), a});
+        });
+
+    m.def("arg", &MakeArg, "Input array with given index");
+    m.def("constant", &MakeConstant, "Constant broadcast to all elements");
+    m.def("add", [](const ExprPtr &a, const ExprPtr &b) {
+        return MakeOp(OpCode::Add, {a, b});
+    });
+    m.def("mul", [](const ExprPtr &a, const ExprPtr &b) {
+        return MakeOp(OpCode::Mul, {a, b});
+    });
+    m.def("fma", [](const ExprPtr &a, const ExprPtr &b, const ExprPtr &c) {
+        return MakeOp(OpCode::Fma, {a, b, c});
+    }, "a * b + c");
+    m.def("reduce_sum", [](const ExprPtr &e) {
+        return MakeReduction(Reduction::Sum, e);
+    });
+    m.def("reduce_min", [](const ExprPtr &e) {
+        return MakeReduction(Reduction::Min, e);
+    });
+    m.def("reduce_max", [](const ExprPtr &e) {
+        return MakeReduction(Reduction::Max, e);
+    });
+    m.def("register", [](const std::string &name, const ExprPtr &e) {
+        // Compile while holding the GIL so that errors are raised in Python
+        KernelRegistry::GetInstance().Register(name, std::make_shared<Kernel>(e));
+    }, "Compile expression and make it available to C++ with given name");
+}
+
+} // namespace native_kernels